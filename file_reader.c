@@ -2,7 +2,218 @@
 
 
 
+static void compressed_image_free(struct compressed_image_t* image) {
+    if (!image) return;
+    for (int i = 0; i < COMPRESSED_BLOCK_CACHE_SLOTS; i++) {
+        free(image->cache[i].data);
+        image->cache[i].data = NULL;
+    }
+    free(image->packed);
+    image->packed = NULL;
+    free(image->index);
+    image->index = NULL;
+    free(image);
+}
+
+
+static bool is_compressed_index_valid(const struct compressed_image_t* const image, const uint64_t file_size) {
+    const uint64_t data_start = sizeof(compressed_header_t) + (image->header.blocks + 1ULL) * sizeof(uint64_t);
+    if (image->index[0] != data_start || image->index[image->header.blocks] != file_size) return false;
+
+    for (uint32_t i = 0; i < image->header.blocks; i++) {
+        if (image->index[i + 1] < image->index[i]) return false;
+        if (image->index[i + 1] - image->index[i] > image->packed_capacity) return false;
+    }
+    return true;
+}
+
+
+/* Returns NULL with errno == 0 when the file is a plain (uncompressed) image */
+static struct compressed_image_t* compressed_image_open(FILE* file) {
+    errno = 0;
+
+    compressed_header_t header;
+    if (fseek(file, 0, SEEK_SET) != 0 || fread(&header, sizeof(header), 1, file) != 1
+        || memcmp(header.magic, COMPRESSED_IMAGE_MAGIC, COMPRESSED_IMAGE_MAGIC_LEN) != 0) {
+        return NULL;
+    }
+
+    if (header.version != COMPRESSED_IMAGE_VERSION || header.block_size == 0 || header.block_size % SECTOR_SIZE != 0
+        || (header.image_size + header.block_size - 1) / header.block_size != header.blocks) {
+        errno = EINVAL;
+        LOG_ERROR("Compressed image header is invalid");
+        return NULL;
+    }
+
+    struct compressed_image_t *image = (struct compressed_image_t*)calloc(1, sizeof(struct compressed_image_t));
+    if (!image) {
+        errno = ENOMEM;
+        LOG_ERROR("Not enough memory");
+        return NULL;
+    }
+
+    image->header = header;
+    image->packed_capacity = compressBound(header.block_size);
+    for (int i = 0; i < COMPRESSED_BLOCK_CACHE_SLOTS; i++) {
+        image->cache[i].block = -1;
+    }
+
+    image->index = (uint64_t*)calloc(header.blocks + 1ULL, sizeof(uint64_t));
+    image->packed = (uint8_t*)malloc(image->packed_capacity);
+    if (!image->index || !image->packed) {
+        compressed_image_free(image);
+        errno = ENOMEM;
+        LOG_ERROR("Not enough memory");
+        return NULL;
+    }
+
+    if (fread(image->index, sizeof(uint64_t), header.blocks + 1ULL, file) != header.blocks + 1ULL
+        || fseek(file, 0, SEEK_END) != 0 || !is_compressed_index_valid(image, (uint64_t)ftell(file))) {
+        compressed_image_free(image);
+        errno = EINVAL;
+        LOG_ERROR("Compressed image index is invalid");
+        return NULL;
+    }
+
+    return image;
+}
+
+
+static size_t compressed_block_length(const struct compressed_image_t* const image, const uint64_t block) {
+    const uint64_t remaining = image->header.image_size - block * image->header.block_size;
+    return remaining < image->header.block_size ? (size_t)remaining : image->header.block_size;
+}
+
+
+/* Least recently used slot is reused, so a handful of hot blocks (FAT, root dir) stay inflated */
+static const uint8_t* compressed_image_get_block(struct compressed_image_t* image, FILE* file, const uint64_t block) {
+    struct block_cache_slot_t *victim = image->cache;
+    image->clock++;
+
+    for (int i = 0; i < COMPRESSED_BLOCK_CACHE_SLOTS; i++) {
+        if (image->cache[i].block == (int64_t)block) {
+            image->cache[i].last_used = image->clock;
+            return image->cache[i].data;
+        }
+        if (image->cache[i].last_used < victim->last_used) victim = image->cache + i;
+    }
+
+    if (!victim->data) {
+        victim->data = (uint8_t*)malloc(image->header.block_size);
+        if (!victim->data) {
+            errno = ENOMEM;
+            LOG_ERROR("Not enough memory");
+            return NULL;
+        }
+    }
+
+    const size_t packed_length = (size_t)(image->index[block + 1] - image->index[block]);
+    const size_t block_length = compressed_block_length(image, block);
+    victim->block = -1;
+
+    if (fseek(file, (long)image->index[block], SEEK_SET) != 0) {
+        errno = ERANGE;
+        LOG_ERROR("Could not seek to compressed block");
+        return NULL;
+    }
+
+    if (packed_length == block_length) {
+        if (fread(victim->data, 1, block_length, file) != block_length) {
+            errno = ERANGE;
+            LOG_ERROR("Could not read stored block");
+            return NULL;
+        }
+    } else {
+        uLongf inflated_length = block_length;
+        if (fread(image->packed, 1, packed_length, file) != packed_length
+            || uncompress(victim->data, &inflated_length, image->packed, packed_length) != Z_OK
+            || inflated_length != block_length) {
+            errno = EIO;
+            LOG_ERROR("Could not inflate compressed block");
+            return NULL;
+        }
+    }
+
+    victim->block = (int64_t)block;
+    victim->last_used = image->clock;
+    return victim->data;
+}
+
+
+static bool compressed_image_read(struct compressed_image_t* image, FILE* file, uint64_t offset, uint8_t* to, size_t length) {
+    if (offset + length > image->header.image_size) {
+        errno = ERANGE;
+        LOG_ERROR("Could not read set number of sectors");
+        return false;
+    }
+
+    while (length > 0) {
+        const uint64_t block = offset / image->header.block_size;
+        const size_t in_block = (size_t)(offset % image->header.block_size);
+        const size_t chunk = image->header.block_size - in_block < length ? image->header.block_size - in_block : length;
+
+        const uint8_t *data = compressed_image_get_block(image, file, block);
+        if (!data) return false;
+
+        memcpy(to, data + in_block, chunk);
+        to += chunk;
+        offset += chunk;
+        length -= chunk;
+    }
+    return true;
+}
+
+
+
+static bool is_sector_size_supported(const uint16_t bytes_per_sector) {
+    for (uint16_t size = SECTOR_SIZE; size <= MAX_SECTOR_SIZE; size <<= 1) {
+        if (bytes_per_sector == size) return true;
+    }
+    return false;
+}
+
+
+/* O_DIRECT is refused by some file systems (tmpfs for one) - aligned reads are kept then, only the page cache is not bypassed */
+static bool open_direct_io(struct disk_t* disk, const char* volume_file_name) {
+    disk->direct_fd = open(volume_file_name, O_RDONLY | O_DIRECT);
+    if (disk->direct_fd == -1 && errno == EINVAL) {
+        disk->direct_fd = open(volume_file_name, O_RDONLY);
+    }
+    if (disk->direct_fd == -1) {
+        LOG_ERROR("Could not open image for direct I/O");
+        return false;
+    }
+
+    if (posix_memalign((void**)&disk->io_window, DIRECT_IO_BLOCK_SIZE, DIRECT_IO_WINDOW_SIZE) != 0) {
+        disk->io_window = NULL;
+        errno = ENOMEM;
+        LOG_ERROR("Not enough memory");
+        return false;
+    }
+    return true;
+}
+
+
+static void release_disk(struct disk_t* disk) {
+    if (disk->direct_fd != -1) close(disk->direct_fd);
+    free(disk->io_window);
+    disk->io_window = NULL;
+    compressed_image_free(disk->compressed);
+    disk->compressed = NULL;
+    if (disk->disk_file) fclose(disk->disk_file);
+    disk->disk_file = NULL;
+    free(disk->VBR);
+    disk->VBR = NULL;
+    free(disk);
+}
+
+
 struct disk_t* disk_open_from_file(const char* volume_file_name) {
+    return disk_open_from_file_ex(volume_file_name, DISK_BUFFERED_IO);
+}
+
+
+struct disk_t* disk_open_from_file_ex(const char* volume_file_name, disk_flags flags) {
 
     if (!volume_file_name) {
         errno = EFAULT;
@@ -16,10 +227,12 @@ struct disk_t* disk_open_from_file(const char* volume_file_name) {
         LOG_ERROR("Not enough memory")
         return NULL;
     }
+    disk->direct_fd = -1;
+    disk->sector_size = SECTOR_SIZE;
 
     disk->VBR = (struct VBR_t*)calloc(1, sizeof(struct VBR_t));
     if (!disk->VBR) {
-        free(disk);
+        release_disk(disk);
         disk = NULL;
         errno = ENOMEM;
         LOG_ERROR("Not enough memory")
@@ -28,28 +241,68 @@ struct disk_t* disk_open_from_file(const char* volume_file_name) {
 
     disk->disk_file = fopen(volume_file_name, "rb");
     if (!disk->disk_file) {
-        free(disk->VBR);
-        disk->VBR = NULL;
-        free(disk);
+        release_disk(disk);
         disk = NULL;
         errno = ENOENT;
         LOG_ERROR("No such file");
         return NULL;
     }
 
+    disk->compressed = compressed_image_open(disk->disk_file);
+    if (!disk->compressed && errno != 0) {
+        release_disk(disk);
+        disk = NULL;
+        return NULL;
+    }
+
+    if ((flags & DISK_DIRECT_IO) && !disk->compressed && !open_direct_io(disk, volume_file_name)) {
+        release_disk(disk);
+        disk = NULL;
+        return NULL;
+    }
+
+    /* VBR always fits in the first SECTOR_SIZE bytes, from then on sectors are as big as the volume says */
     if (disk_read(disk, 0, disk->VBR, 1) == -1) {
-        free(disk->VBR);
-        disk->VBR = NULL;
-        fclose(disk->disk_file);
-        free(disk);
+        release_disk(disk);
         disk = NULL;
         return NULL;
     }
 
+    if (is_sector_size_supported(disk->VBR->bytes_per_sector)) {
+        disk->sector_size = disk->VBR->bytes_per_sector;
+    }
+
     return disk;
 }
 
 
+static bool direct_read(struct disk_t* from, uint64_t offset, uint8_t* to, size_t length) {
+    while (length > 0) {
+        if (offset < from->io_window_start || offset >= from->io_window_start + from->io_window_length) {
+            from->io_window_start = offset - offset % DIRECT_IO_BLOCK_SIZE;
+            from->io_window_length = 0;
+
+            const ssize_t read_bytes = pread(from->direct_fd, from->io_window, DIRECT_IO_WINDOW_SIZE, (off_t)from->io_window_start);
+            if (read_bytes <= 0 || offset >= from->io_window_start + (uint64_t)read_bytes) {
+                errno = ERANGE;
+                LOG_ERROR("Could not read set number of sectors");
+                return false;
+            }
+            from->io_window_length = (size_t)read_bytes;
+        }
+
+        const size_t in_window = (size_t)(offset - from->io_window_start);
+        const size_t chunk = from->io_window_length - in_window < length ? from->io_window_length - in_window : length;
+
+        memcpy(to, from->io_window + in_window, chunk);
+        to += chunk;
+        offset += chunk;
+        length -= chunk;
+    }
+    return true;
+}
+
+
 int disk_read(struct disk_t* from, int32_t first_sector, void* to, int32_t sectors_to_read) {
 
     if (!from || !to) {
@@ -64,9 +317,26 @@ int disk_read(struct disk_t* from, int32_t first_sector, void* to, int32_t secto
         return -1;
     }
 
-    fseek(from->disk_file, first_sector * SECTOR_SIZE, SEEK_SET);
+    const uint64_t offset = (uint64_t)first_sector * from->sector_size;
+    const size_t length = (size_t)sectors_to_read * from->sector_size;
+
+    if (from->compressed) {
+        if (!compressed_image_read(from->compressed, from->disk_file, offset, (uint8_t*)to, length)) {
+            return -1;
+        }
+        return sectors_to_read;
+    }
+
+    if (from->direct_fd != -1) {
+        if (!direct_read(from, offset, (uint8_t*)to, length)) {
+            return -1;
+        }
+        return sectors_to_read;
+    }
+
+    fseeko(from->disk_file, (off_t)offset, SEEK_SET);
 
-    int32_t read_blocks = (int32_t)fread(to, SECTOR_SIZE, sectors_to_read, from->disk_file);
+    int32_t read_blocks = (int32_t)fread(to, from->sector_size, sectors_to_read, from->disk_file);
     if (read_blocks != sectors_to_read) {
         errno = ERANGE;
         LOG_ERROR("Could not read set number of sectors");
@@ -84,10 +354,7 @@ int disk_close(struct disk_t* pdisk) {
         return -1;
     }
 
-    fclose(pdisk->disk_file);
-    free(pdisk->VBR);
-    pdisk->VBR = NULL;
-    free(pdisk);
+    release_disk(pdisk);
     pdisk = NULL;
     return 0;
 }
@@ -95,7 +362,7 @@ int disk_close(struct disk_t* pdisk) {
 
 static bool is_VBR_valid(const VBR_t* const VBR) {
     if (VBR->reserved_sectors == 0) return false;
-    if (VBR->bytes_per_sector == 0 || ((VBR->root_entries * sizeof(Entry_t)) % VBR->bytes_per_sector) != 0) return false;
+    if (!is_sector_size_supported(VBR->bytes_per_sector) || ((VBR->root_entries * sizeof(Entry_t)) % VBR->bytes_per_sector) != 0) return false;
     if (VBR->sectors_per_FAT < 1) return false;
     if (VBR->signature != SIGNATURE_VALUE) return false;
     if (!(VBR->small_sectors == 0 ^ VBR->large_sectors == 0)) return false;
@@ -131,8 +398,8 @@ static bool load_FATs(struct volume_t* const volume) {
         volume->FATs_handler[i] = (uint8_t*)calloc(1, FAT_memory_size);
         if (!volume->FATs_handler[i]) {
             for (int j = 0; j < i; j++) {
-                free(volume->FATs_handler[i]);
-                volume->FATs_handler[i] = NULL;
+                free(volume->FATs_handler[j]);
+                volume->FATs_handler[j] = NULL;
             }
             free(volume->FATs_handler);
             volume->FATs_handler = NULL;
@@ -189,11 +456,12 @@ static bool load_FATs(struct volume_t* const volume) {
 //    }
 
     volume->FAT_mem = (uint16_t *)volume->FATs_handler[0];
-    free(volume->FATs_handler);
     for (int i = 1; i < volume->disk->VBR->FATs; i++) {
         free(volume->FATs_handler[i]);
         volume->FATs_handler[i] = NULL;
     }
+    free(volume->FATs_handler);
+    volume->FATs_handler = NULL;
 //    memcpy(volume->FAT_mem, volume->handler.FATs_handler[0], FAT_memory_size);
     volume->eoc_marker = volume->FAT_mem[1];
     if (volume->eoc_marker < EOC_MARKER_LOW_BOUNDARY) {
@@ -417,18 +685,21 @@ size_t file_read(void *ptr, size_t size, size_t nmemb, struct file_t *stream) {
         return -1;
     }
 
+    const uint16_t bytes_per_sector = stream->in_volume->disk->sector_size;
+    const uint8_t sectors_per_cluster = stream->in_volume->disk->VBR->sectors_per_cluster;
+
     lba_t current_cluster = stream->start_of_chain;
     lba_t current_cluster_physical = get_physical_address(current_cluster, stream->in_volume);
 
-    lba_t sector_offset = stream->offset / stream->in_volume->disk->VBR->bytes_per_sector;
-    cluster_t cluster_offset = sector_offset / stream->in_volume->disk->VBR->sectors_per_cluster;
-    sector_offset %= stream->in_volume->disk->VBR->sectors_per_cluster;
+    lba_t sector_offset = stream->offset / bytes_per_sector;
+    cluster_t cluster_offset = sector_offset / sectors_per_cluster;
+    sector_offset %= sectors_per_cluster;
 
-    lba_t byte_offset = stream->offset % stream->in_volume->disk->VBR->bytes_per_sector;
+    lba_t byte_offset = stream->offset % bytes_per_sector;
 
     long remain_to_read = size * nmemb > stream->size - stream->offset ? (long)(stream->size - stream->offset) : (long)(size * nmemb);
     long read_bytes = 0, length;
-    char sector_data[SECTOR_SIZE + 1] = {0};
+    uint8_t sector_data[MAX_SECTOR_SIZE];
 
     while (cluster_offset-- != 0) {
         current_cluster = get_next_cluster(current_cluster, stream->in_volume);
@@ -438,40 +709,38 @@ size_t file_read(void *ptr, size_t size, size_t nmemb, struct file_t *stream) {
     while (true) {
         if (stream->size == stream->offset) return 0;
 
-        int read_blocks = disk_read(stream->in_volume->disk, current_cluster_physical + sector_offset, sector_data, 1);
-        if (read_blocks != 1) {
-            errno = ERANGE;
-            LOG_ERROR("Disk read failed");
-            return -1;
-        }
+        if (byte_offset == 0 && remain_to_read >= bytes_per_sector) {
+            //Whole sectors go straight to the caller, as many as are left in this cluster
+            int32_t sectors = (int32_t)(remain_to_read / bytes_per_sector);
+            if (sectors > (int32_t)(sectors_per_cluster - sector_offset)) sectors = (int32_t)(sectors_per_cluster - sector_offset);
 
-        bool new_sector = false;
-        if (remain_to_read > SECTOR_SIZE) {
-            length = SECTOR_SIZE;
-            remain_to_read -= length;
-            stream->offset += length;
-            memcpy( (void*) ((uint8_t *)ptr + read_bytes), sector_data + byte_offset, length);
-            sector_offset++;
-            read_bytes += length;
+            int read_blocks = disk_read(stream->in_volume->disk, current_cluster_physical + sector_offset, (uint8_t *)ptr + read_bytes, sectors);
+            if (read_blocks != sectors) {
+                errno = ERANGE;
+                LOG_ERROR("Disk read failed");
+                return -1;
+            }
+            length = (long)sectors * bytes_per_sector;
+            sector_offset += sectors;
         } else {
-            int pos_in_sector = (int)stream->offset % SECTOR_SIZE;
-            if (remain_to_read > (SECTOR_SIZE - pos_in_sector)) {
-                length = SECTOR_SIZE - pos_in_sector;
-                remain_to_read -= length;
-                sector_offset++;
-                new_sector = true;
-            } else {
-                length = remain_to_read;
-                remain_to_read = 0;
+            int read_blocks = disk_read(stream->in_volume->disk, current_cluster_physical + sector_offset, sector_data, 1);
+            if (read_blocks != 1) {
+                errno = ERANGE;
+                LOG_ERROR("Disk read failed");
+                return -1;
             }
-            stream->offset += length;
+            length = remain_to_read > (long)(bytes_per_sector - byte_offset) ? (long)(bytes_per_sector - byte_offset) : remain_to_read;
             memcpy( (void*) ((uint8_t *)ptr + read_bytes), sector_data + byte_offset, length);
-            read_bytes += length;
+            if (byte_offset + length == bytes_per_sector) sector_offset++;
         }
 
-        if (new_sector) byte_offset = 0;
+        remain_to_read -= length;
+        stream->offset += length;
+        read_bytes += length;
+        byte_offset = 0;
+
         if (remain_to_read > 0) {
-            if (sector_offset >= stream->in_volume->disk->VBR->sectors_per_cluster) {
+            if (sector_offset >= sectors_per_cluster) {
                 current_cluster = get_next_cluster(current_cluster, stream->in_volume);
                 current_cluster_physical = get_physical_address(current_cluster, stream->in_volume);
                 sector_offset = 0;
@@ -557,6 +826,66 @@ struct dir_t* dir_open(struct volume_t* pvolume, const char* dir_path) {
 }
 
 
+static bool is_entry_hidden_from_listing(const Entry_t * const entry) {
+    return (entry->attributes & VOLUME_LABEL) || (entry->filename[0] == DELETED);
+}
+
+
+/* FAT date: bits 15-9 years since 1980, bits 8-5 month, bits 4-0 day */
+static void decode_date(const uint16_t yy_mm_dd, struct fat_time_t* to) {
+    to->year = 1980 + (yy_mm_dd >> 9);
+    to->month = (yy_mm_dd >> 5) & 0x0F;
+    to->day = yy_mm_dd & 0x1F;
+}
+
+
+/* FAT time: bits 15-11 hours, bits 10-5 minutes, bits 4-0 seconds / 2; tens holds extra 10 ms units */
+static void decode_time(const uint16_t hh_mm_ss, const uint8_t seconds_tens, struct fat_time_t* to) {
+    to->hours = hh_mm_ss >> 11;
+    to->minutes = (hh_mm_ss >> 5) & 0x3F;
+    to->seconds = (uint8_t)((hh_mm_ss & 0x1F) * 2 + seconds_tens / 100);
+    to->hundredths = seconds_tens % 100;
+}
+
+
+static void decode_creation_time(const Entry_t * const entry, struct fat_time_t* to) {
+    decode_date(entry->creation_time.yy_mm_dd, to);
+    decode_time(entry->creation_time.hh_mm_ss, entry->creation_time.seconds_tens, to);
+}
+
+
+static void decode_modify_time(const Entry_t * const entry, struct fat_time_t* to) {
+    decode_date(entry->modify_time.yy_mm_dd, to);
+    decode_time(entry->modify_time.hh_mm_ss, 0, to);
+}
+
+
+static void decode_access_date(const Entry_t * const entry, struct fat_time_t* to) {
+    memset(to, 0, sizeof(*to));
+    decode_date(entry->access_date, to);
+}
+
+
+static cluster_t get_first_cluster(const Entry_t * const entry) {
+    return ((cluster_t)entry->first_cluster_address_high_order << 16) | entry->first_cluster_address_low_order;
+}
+
+
+static void decode_entry(const Entry_t * const entry, struct dir_entry_t* pentry) {
+    pentry->size = entry->file_size;
+    parse_filename(entry, pentry->name);
+    pentry->is_readonly = (entry->attributes & READ_ONLY) != 0;
+    pentry->is_archived = (entry->attributes & ARCHIVE) != 0;
+    pentry->is_directory = (entry->attributes & DIRECTORY) != 0;
+    pentry->is_hidden = (entry->attributes & HIDDEN_FILE) != 0;
+    pentry->is_system = (entry->attributes & SYSTEM_FILE) != 0;
+    pentry->first_cluster = get_first_cluster(entry);
+    decode_creation_time(entry, &pentry->creation_time);
+    decode_modify_time(entry, &pentry->modify_time);
+    decode_access_date(entry, &pentry->access_date);
+}
+
+
 int dir_read(struct dir_t* pdir, struct dir_entry_t* pentry) {
 
     if (!pdir || !pdir->entry || !pentry) {
@@ -565,26 +894,66 @@ int dir_read(struct dir_t* pdir, struct dir_entry_t* pentry) {
         return -1;
     }
 
-    if (pdir->current_dir_entry == pdir->amount) return 1;
-
     for (; pdir->current_dir_entry < pdir->amount; pdir->current_dir_entry++) {
-        if ((pdir->entry[pdir->current_dir_entry].attributes & VOLUME_LABEL) || (pdir->entry[pdir->current_dir_entry].filename[0] == DELETED)) {
-            continue;
-        } else break;
+        if (!is_entry_hidden_from_listing(pdir->entry + pdir->current_dir_entry)) break;
     }
 
-    pentry->size = (pdir->entry + pdir->current_dir_entry)->file_size;
-    parse_filename(pdir->entry + pdir->current_dir_entry, pentry->name);
-    pentry->is_readonly = ((pdir->entry + pdir->current_dir_entry)->attributes & READ_ONLY) != 0;
-    pentry->is_archived = ((pdir->entry + pdir->current_dir_entry)->attributes & ARCHIVE) != 0;
-    pentry->is_directory = ((pdir->entry + pdir->current_dir_entry)->attributes & DIRECTORY) != 0;
-    pentry->is_hidden = ((pdir->entry + pdir->current_dir_entry)->attributes & HIDDEN_FILE) != 0;
-    pentry->is_system = ((pdir->entry + pdir->current_dir_entry)->attributes & SYSTEM_FILE) != 0;
+    if (pdir->current_dir_entry == pdir->amount) return 1;
+
+    decode_entry(pdir->entry + pdir->current_dir_entry, pentry);
     pdir->current_dir_entry++;
     return 0;
 }
 
 
+/* Fills up to `max` entries in a single pass over the raw entries; returns amount filled, 0 at the end */
+int dir_read_batch(struct dir_t* pdir, struct dir_entry_t* entries, size_t max) {
+
+    if (!pdir || !pdir->entry || !entries) {
+        errno = EFAULT;
+        LOG_ERROR("Null pointer exception");
+        return -1;
+    }
+
+    size_t filled = 0;
+    for (; pdir->current_dir_entry < pdir->amount && filled < max; pdir->current_dir_entry++) {
+        const Entry_t * const entry = pdir->entry + pdir->current_dir_entry;
+        if (is_entry_hidden_from_listing(entry)) continue;
+        decode_entry(entry, entries + filled);
+        filled++;
+    }
+
+    return (int)filled;
+}
+
+
+int dir_read_batch_soa(struct dir_t* pdir, struct dir_entries_soa_t* columns, size_t max) {
+
+    if (!pdir || !pdir->entry || !columns) {
+        errno = EFAULT;
+        LOG_ERROR("Null pointer exception");
+        return -1;
+    }
+
+    size_t filled = 0;
+    for (; pdir->current_dir_entry < pdir->amount && filled < max; pdir->current_dir_entry++) {
+        const Entry_t * const entry = pdir->entry + pdir->current_dir_entry;
+        if (is_entry_hidden_from_listing(entry)) continue;
+
+        if (columns->name) parse_filename(entry, columns->name[filled]);
+        if (columns->size) columns->size[filled] = entry->file_size;
+        if (columns->attributes) columns->attributes[filled] = entry->attributes;
+        if (columns->first_cluster) columns->first_cluster[filled] = get_first_cluster(entry);
+        if (columns->creation_time) decode_creation_time(entry, columns->creation_time + filled);
+        if (columns->modify_time) decode_modify_time(entry, columns->modify_time + filled);
+        if (columns->access_date) decode_access_date(entry, columns->access_date + filled);
+        filled++;
+    }
+
+    return (int)filled;
+}
+
+
 int dir_close(struct dir_t* pdir) {
     if (!pdir) {
         errno = EFAULT;
@@ -593,3 +962,900 @@ int dir_close(struct dir_t* pdir) {
     }
     return 0;
 }
+
+
+uint32_t fat_timestamp(const struct fat_time_t* time) {
+    if (!time || time->year < 1980) return 0;
+    const uint16_t date = (uint16_t)(((time->year - 1980) << 9) | (time->month << 5) | time->day);
+    const uint16_t hh_mm_ss = (uint16_t)((time->hours << 11) | (time->minutes << 5) | (time->seconds / 2));
+    return ((uint32_t)date << 16) | hh_mm_ss;
+}
+
+
+static bool catalog_reserve(struct catalog_t* catalog, const size_t capacity) {
+    if (capacity <= catalog->capacity) return true;
+
+    void *name = realloc(catalog->name, capacity * sizeof(*catalog->name));
+    if (name) catalog->name = (char (*)[14])name;
+    void *parent = realloc(catalog->parent, capacity * sizeof(*catalog->parent));
+    if (parent) catalog->parent = (uint32_t*)parent;
+    void *size = realloc(catalog->size, capacity * sizeof(*catalog->size));
+    if (size) catalog->size = (uint32_t*)size;
+    void *attributes = realloc(catalog->attributes, capacity * sizeof(*catalog->attributes));
+    if (attributes) catalog->attributes = (uint8_t*)attributes;
+    void *modify_time = realloc(catalog->modify_time, capacity * sizeof(*catalog->modify_time));
+    if (modify_time) catalog->modify_time = (uint32_t*)modify_time;
+    void *creation_time = realloc(catalog->creation_time, capacity * sizeof(*catalog->creation_time));
+    if (creation_time) catalog->creation_time = (uint32_t*)creation_time;
+    void *access_date = realloc(catalog->access_date, capacity * sizeof(*catalog->access_date));
+    if (access_date) catalog->access_date = (uint16_t*)access_date;
+    void *first_cluster = realloc(catalog->first_cluster, capacity * sizeof(*catalog->first_cluster));
+    if (first_cluster) catalog->first_cluster = (cluster_t*)first_cluster;
+
+    if (!name || !parent || !size || !attributes || !modify_time || !creation_time || !access_date || !first_cluster) {
+        errno = ENOMEM;
+        LOG_ERROR("Not enough memory");
+        return false;
+    }
+
+    catalog->capacity = capacity;
+    return true;
+}
+
+
+static bool catalog_append(struct catalog_t* catalog, const Entry_t* const entry, const uint32_t parent) {
+    if (catalog->count == catalog->capacity && !catalog_reserve(catalog, catalog->capacity ? catalog->capacity * 2 : 64)) {
+        return false;
+    }
+
+    const size_t row = catalog->count++;
+    memset(catalog->name[row], 0, sizeof(*catalog->name));
+    parse_filename(entry, catalog->name[row]);
+    catalog->parent[row] = parent;
+    catalog->size[row] = entry->file_size;
+    catalog->attributes[row] = entry->attributes;
+    catalog->modify_time[row] = ((uint32_t)entry->modify_time.yy_mm_dd << 16) | entry->modify_time.hh_mm_ss;
+    catalog->creation_time[row] = ((uint32_t)entry->creation_time.yy_mm_dd << 16) | entry->creation_time.hh_mm_ss;
+    catalog->access_date[row] = entry->access_date;
+    catalog->first_cluster[row] = get_first_cluster(entry);
+    return true;
+}
+
+
+/* Appends entries of one directory; stops at the end-of-directory marker */
+static bool catalog_append_entries(struct catalog_t* catalog, const Entry_t* const entries, const size_t amount, const uint32_t parent, bool* end_reached) {
+    for (size_t i = 0; i < amount; i++) {
+        if (entries[i].filename[0] == '\x0') {
+            *end_reached = true;
+            return true;
+        }
+        if (is_entry_hidden_from_listing(entries + i) || entries[i].filename[0] == '.') continue;
+        if (!catalog_append(catalog, entries + i, parent)) return false;
+    }
+    return true;
+}
+
+
+static size_t FAT_entries_of(const struct volume_t* const volume) {
+    return (size_t)volume->disk->VBR->sectors_per_FAT * volume->disk->VBR->bytes_per_sector / sizeof(uint16_t);
+}
+
+
+/* visited has one bit per cluster; a directory cluster read twice means a looped chain or a
+ * subdirectory pointing at itself or at one of its ancestors                                 */
+static bool catalog_append_subdir(struct catalog_t* catalog, struct volume_t* volume, const uint32_t dir_row, uint8_t* cluster_data, uint64_t* visited) {
+    const VBR_t * const VBR = volume->disk->VBR;
+    const size_t cluster_bytes = (size_t)VBR->sectors_per_cluster * volume->disk->sector_size;
+    const size_t FAT_entries = FAT_entries_of(volume);
+
+    cluster_t cluster = catalog->first_cluster[dir_row];
+    bool end_reached = false;
+
+    while (!end_reached && cluster >= 2 && cluster < FAT_entries && cluster < EOC_MARKER_LOW_BOUNDARY) {
+        if (visited[cluster / 64] & ((uint64_t)1 << (cluster % 64))) {
+            errno = EINVAL;
+            LOG_ERROR("Directory cluster chain is looped");
+            return false;
+        }
+        visited[cluster / 64] |= (uint64_t)1 << (cluster % 64);
+
+        if (disk_read(volume->disk, get_physical_address(cluster, volume), cluster_data, VBR->sectors_per_cluster) != VBR->sectors_per_cluster) {
+            return false;
+        }
+        if (!catalog_append_entries(catalog, (const Entry_t*)cluster_data, cluster_bytes / sizeof(Entry_t), dir_row, &end_reached)) {
+            return false;
+        }
+        cluster = get_next_cluster(cluster, volume);
+    }
+    return true;
+}
+
+
+struct catalog_t* catalog_build(struct volume_t* pvolume) {
+
+    if (!pvolume || !pvolume->disk || !pvolume->FAT_mem || !pvolume->root_dir_entries) {
+        errno = EFAULT;
+        LOG_ERROR("Null pointer exception");
+        return NULL;
+    }
+
+    struct catalog_t *catalog = (struct catalog_t*)calloc(1, sizeof(struct catalog_t));
+    uint8_t *cluster_data = (uint8_t*)malloc((size_t)pvolume->disk->VBR->sectors_per_cluster * pvolume->disk->sector_size);
+    uint64_t *visited = (uint64_t*)calloc(FAT_entries_of(pvolume) / 64 + 1, sizeof(uint64_t));
+    if (!catalog || !cluster_data || !visited) {
+        free(catalog);
+        free(cluster_data);
+        free(visited);
+        errno = ENOMEM;
+        LOG_ERROR("Not enough memory");
+        return NULL;
+    }
+    catalog->serial_number = pvolume->disk->VBR->serial_number;
+
+    bool end_reached = false;
+    bool success = catalog_append_entries(catalog, pvolume->root_dir_entries, pvolume->entries_amount, CATALOG_NO_PARENT, &end_reached);
+
+    //Rows appended behind the cursor are visited later, so the whole tree is walked in one pass
+    for (size_t row = 0; success && row < catalog->count; row++) {
+        if (catalog->attributes[row] & DIRECTORY) {
+            success = catalog_append_subdir(catalog, pvolume, (uint32_t)row, cluster_data, visited);
+        }
+    }
+
+    free(cluster_data);
+    free(visited);
+    if (!success) {
+        catalog_close(catalog);
+        return NULL;
+    }
+    return catalog;
+}
+
+
+int catalog_close(struct catalog_t* pcatalog) {
+    if (!pcatalog) {
+        errno = EFAULT;
+        LOG_ERROR("Null pointer exception");
+        return -1;
+    }
+
+    free(pcatalog->name);
+    free(pcatalog->parent);
+    free(pcatalog->size);
+    free(pcatalog->attributes);
+    free(pcatalog->modify_time);
+    free(pcatalog->creation_time);
+    free(pcatalog->access_date);
+    free(pcatalog->first_cluster);
+    free(pcatalog);
+    pcatalog = NULL;
+    return 0;
+}
+
+
+void catalog_query_init(struct catalog_query_t* query) {
+    if (!query) return;
+    memset(query, 0, sizeof(*query));
+    query->max_size = UINT32_MAX;
+    query->modified_before = UINT32_MAX;
+}
+
+
+/* Each filter ANDs its predicate into the bitmap, 64 rows per word */
+static void filter_range(const uint32_t* column, const size_t count, const uint32_t low, const uint32_t high, uint64_t* bitmap) {
+    if (low == 0 && high == UINT32_MAX) return;
+
+    for (size_t word = 0; word * 64 < count; word++) {
+        const size_t first = word * 64;
+        const size_t last = first + 64 < count ? first + 64 : count;
+        uint64_t bits = 0;
+        size_t i = first;
+#ifdef __SSE2__
+        //SSE2 compares signed only, flipping the sign bit maps unsigned order onto signed one
+        const __m128i sign = _mm_set1_epi32((int32_t)0x80000000);
+        const __m128i low_v = _mm_xor_si128(_mm_set1_epi32((int32_t)low), sign);
+        const __m128i high_v = _mm_xor_si128(_mm_set1_epi32((int32_t)high), sign);
+        for (; i + 4 <= last; i += 4) {
+            const __m128i value = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(column + i)), sign);
+            const __m128i outside = _mm_or_si128(_mm_cmpgt_epi32(low_v, value), _mm_cmpgt_epi32(value, high_v));
+            bits |= (uint64_t)(~_mm_movemask_ps(_mm_castsi128_ps(outside)) & 0xF) << (i - first);
+        }
+#endif
+        for (; i < last; i++) {
+            bits |= (uint64_t)(column[i] >= low && column[i] <= high) << (i - first);
+        }
+        bitmap[word] &= bits;
+    }
+}
+
+
+static void filter_attributes(const uint8_t* column, const size_t count, const struct catalog_query_t* const query, uint64_t* bitmap) {
+    if (!query->attributes_all && !query->attributes_any && !query->attributes_none) return;
+
+    for (size_t word = 0; word * 64 < count; word++) {
+        const size_t first = word * 64;
+        const size_t last = first + 64 < count ? first + 64 : count;
+        uint64_t bits = 0;
+        size_t i = first;
+#ifdef __SSE2__
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i all = _mm_set1_epi8((char)query->attributes_all);
+        const __m128i any = _mm_set1_epi8((char)query->attributes_any);
+        const __m128i none = _mm_set1_epi8((char)query->attributes_none);
+        const int any_ignored = query->attributes_any ? 0 : 0xFFFF;
+        for (; i + 16 <= last; i += 16) {
+            const __m128i value = _mm_loadu_si128((const __m128i*)(column + i));
+            const int has_all = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(value, all), all));
+            const int has_any = ~_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(value, any), zero)) | any_ignored;
+            const int has_none = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(value, none), zero));
+            bits |= (uint64_t)(has_all & has_any & has_none & 0xFFFF) << (i - first);
+        }
+#endif
+        for (; i < last; i++) {
+            const bool matches = (column[i] & query->attributes_all) == query->attributes_all
+                                 && (!query->attributes_any || (column[i] & query->attributes_any))
+                                 && !(column[i] & query->attributes_none);
+            bits |= (uint64_t)matches << (i - first);
+        }
+        bitmap[word] &= bits;
+    }
+}
+
+
+/* Writes up to `max` matching rows; returns amount of all matching rows */
+int catalog_filter(const struct catalog_t* pcatalog, const struct catalog_query_t* query, uint32_t* rows, size_t max) {
+
+    if (!pcatalog || !query || (!rows && max)) {
+        errno = EFAULT;
+        LOG_ERROR("Null pointer exception");
+        return -1;
+    }
+
+    const size_t words = (pcatalog->count + 63) / 64;
+    uint64_t *bitmap = (uint64_t*)malloc((words ? words : 1) * sizeof(uint64_t));
+    if (!bitmap) {
+        errno = ENOMEM;
+        LOG_ERROR("Not enough memory");
+        return -1;
+    }
+
+    for (size_t word = 0; word < words; word++) {
+        const size_t rows_in_word = pcatalog->count - word * 64;
+        bitmap[word] = rows_in_word >= 64 ? UINT64_MAX : (((uint64_t)1 << rows_in_word) - 1);
+    }
+
+    filter_range(pcatalog->size, pcatalog->count, query->min_size, query->max_size, bitmap);
+    filter_range(pcatalog->modify_time, pcatalog->count, query->modified_after, query->modified_before, bitmap);
+    filter_attributes(pcatalog->attributes, pcatalog->count, query, bitmap);
+
+    size_t matched = 0;
+    for (size_t word = 0; word < words; word++) {
+        for (uint64_t bits = bitmap[word]; bits; bits &= bits - 1) {
+            if (matched < max) rows[matched] = (uint32_t)(word * 64 + __builtin_ctzll(bits));
+            matched++;
+        }
+    }
+
+    free(bitmap);
+    return (int)matched;
+}
+
+
+static int compare_rows(const struct catalog_t* const catalog, const catalog_key key, const uint32_t a, const uint32_t b) {
+    switch (key) {
+        case CATALOG_BY_NAME:
+            return strcmp(catalog->name[a], catalog->name[b]);
+        case CATALOG_BY_SIZE:
+            return (catalog->size[a] > catalog->size[b]) - (catalog->size[a] < catalog->size[b]);
+        case CATALOG_BY_MODIFY_TIME:
+            return (catalog->modify_time[a] > catalog->modify_time[b]) - (catalog->modify_time[a] < catalog->modify_time[b]);
+        case CATALOG_BY_CREATION_TIME:
+            return (catalog->creation_time[a] > catalog->creation_time[b]) - (catalog->creation_time[a] < catalog->creation_time[b]);
+        default:
+            return (catalog->first_cluster[a] > catalog->first_cluster[b]) - (catalog->first_cluster[a] < catalog->first_cluster[b]);
+    }
+}
+
+
+/* Stable bottom-up merge sort of row numbers, keeps rows with equal keys in their previous order */
+int catalog_sort(const struct catalog_t* pcatalog, uint32_t* rows, size_t count, catalog_key key, bool descending) {
+
+    if (!pcatalog || (!rows && count)) {
+        errno = EFAULT;
+        LOG_ERROR("Null pointer exception");
+        return -1;
+    }
+
+    if (key > CATALOG_BY_FIRST_CLUSTER) {
+        errno = EINVAL;
+        LOG_ERROR("Incorrect sort key");
+        return -1;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        if (rows[i] >= pcatalog->count) {
+            errno = ERANGE;
+            LOG_ERROR("Index out of bounds");
+            return -1;
+        }
+    }
+
+    uint32_t *buffer = (uint32_t*)malloc((count ? count : 1) * sizeof(uint32_t));
+    if (!buffer) {
+        errno = ENOMEM;
+        LOG_ERROR("Not enough memory");
+        return -1;
+    }
+
+    uint32_t *from = rows, *to = buffer;
+    for (size_t width = 1; width < count; width *= 2) {
+        for (size_t left = 0; left < count; left += 2 * width) {
+            const size_t middle = left + width < count ? left + width : count;
+            const size_t right = left + 2 * width < count ? left + 2 * width : count;
+            size_t i = left, j = middle, k = left;
+
+            while (i < middle && j < right) {
+                int order = compare_rows(pcatalog, key, from[i], from[j]);
+                if (descending) order = -order;
+                to[k++] = order <= 0 ? from[i++] : from[j++];
+            }
+            while (i < middle) to[k++] = from[i++];
+            while (j < right) to[k++] = from[j++];
+        }
+        uint32_t *swap = from;
+        from = to;
+        to = swap;
+    }
+
+    if (from != rows) memcpy(rows, from, count * sizeof(uint32_t));
+    free(buffer);
+    return 0;
+}
+
+
+int catalog_path(const struct catalog_t* pcatalog, uint32_t row, char* buffer, size_t buffer_size) {
+
+    if (!pcatalog || !buffer) {
+        errno = EFAULT;
+        LOG_ERROR("Null pointer exception");
+        return -1;
+    }
+
+    if (row >= pcatalog->count || buffer_size == 0) {
+        errno = ERANGE;
+        LOG_ERROR("Index out of bounds");
+        return -1;
+    }
+
+    //Path is assembled from the end, walking up the parent column
+    size_t position = buffer_size - 1;
+    buffer[position] = '\x0';
+    for (size_t depth = 0; row != CATALOG_NO_PARENT; depth++) {
+        const size_t length = strlen(pcatalog->name[row]);
+        if (length + 1 > position || depth > pcatalog->count) {
+            errno = ERANGE;
+            LOG_ERROR("Path does not fit into buffer");
+            return -1;
+        }
+        position -= length;
+        memcpy(buffer + position, pcatalog->name[row], length);
+        buffer[--position] = '/';
+        row = pcatalog->parent[row];
+    }
+
+    memmove(buffer, buffer + position, buffer_size - position);
+    return 0;
+}
+
+
+static char* catalog_file_name(const char* volume_file_name) {
+    char *name = (char*)malloc(strlen(volume_file_name) + sizeof(CATALOG_FILE_SUFFIX));
+    if (!name) {
+        errno = ENOMEM;
+        LOG_ERROR("Not enough memory");
+        return NULL;
+    }
+    sprintf(name, "%s%s", volume_file_name, CATALOG_FILE_SUFFIX);
+    return name;
+}
+
+
+static size_t catalog_row_bytes(void) {
+    const struct catalog_t *catalog = NULL;
+    return sizeof(*catalog->name) + sizeof(*catalog->parent) + sizeof(*catalog->size) + sizeof(*catalog->attributes)
+           + sizeof(*catalog->modify_time) + sizeof(*catalog->creation_time) + sizeof(*catalog->access_date) + sizeof(*catalog->first_cluster);
+}
+
+
+static bool stat_image(const char* volume_file_name, uint64_t* size, int64_t* mtime) {
+    struct stat image;
+    *size = 0;
+    *mtime = 0;
+    if (stat(volume_file_name, &image) != 0) {
+        LOG_ERROR("Could not stat image");
+        return false;
+    }
+    *size = (uint64_t)image.st_size;
+    *mtime = (int64_t)image.st_mtim.tv_sec * 1000000000 + image.st_mtim.tv_nsec;
+    return true;
+}
+
+
+/* Catalog file: header | name column | parent column | size column | ... in catalog_t field order */
+int catalog_save(const struct catalog_t* pcatalog, const char* volume_file_name) {
+
+    if (!pcatalog || !volume_file_name) {
+        errno = EFAULT;
+        LOG_ERROR("Null pointer exception");
+        return -1;
+    }
+
+    uint64_t image_size = 0;
+    int64_t image_mtime = 0;
+    if (!stat_image(volume_file_name, &image_size, &image_mtime)) return -1;
+
+    char *file_name = catalog_file_name(volume_file_name);
+    if (!file_name) return -1;
+
+    FILE *file = fopen(file_name, "wb");
+    if (!file) {
+        LOG_ERROR("Could not create catalog file");
+        free(file_name);
+        return -1;
+    }
+
+    catalog_header_t header = {0};
+    memcpy(header.magic, CATALOG_MAGIC, CATALOG_MAGIC_LEN);
+    header.version = CATALOG_VERSION;
+    header.serial_number = pcatalog->serial_number;
+    header.count = pcatalog->count;
+    header.image_size = image_size;
+    header.image_mtime = image_mtime;
+
+    const size_t count = pcatalog->count;
+    bool success = fwrite(&header, sizeof(header), 1, file) == 1
+                   && fwrite(pcatalog->name, sizeof(*pcatalog->name), count, file) == count
+                   && fwrite(pcatalog->parent, sizeof(*pcatalog->parent), count, file) == count
+                   && fwrite(pcatalog->size, sizeof(*pcatalog->size), count, file) == count
+                   && fwrite(pcatalog->attributes, sizeof(*pcatalog->attributes), count, file) == count
+                   && fwrite(pcatalog->modify_time, sizeof(*pcatalog->modify_time), count, file) == count
+                   && fwrite(pcatalog->creation_time, sizeof(*pcatalog->creation_time), count, file) == count
+                   && fwrite(pcatalog->access_date, sizeof(*pcatalog->access_date), count, file) == count
+                   && fwrite(pcatalog->first_cluster, sizeof(*pcatalog->first_cluster), count, file) == count;
+    success = fclose(file) == 0 && success;
+
+    if (!success) {
+        errno = EIO;
+        LOG_ERROR("Could not write catalog file");
+        remove(file_name);
+    }
+    free(file_name);
+    return success ? 0 : -1;
+}
+
+
+/* Rejects a catalog saved for another volume or before the image file was last modified */
+struct catalog_t* catalog_load(const struct disk_t* pdisk, const char* volume_file_name) {
+
+    if (!pdisk || !pdisk->VBR || !volume_file_name) {
+        errno = EFAULT;
+        LOG_ERROR("Null pointer exception");
+        return NULL;
+    }
+
+    uint64_t image_size = 0;
+    int64_t image_mtime = 0;
+    if (!stat_image(volume_file_name, &image_size, &image_mtime)) return NULL;
+
+    char *file_name = catalog_file_name(volume_file_name);
+    if (!file_name) return NULL;
+
+    FILE *file = fopen(file_name, "rb");
+    free(file_name);
+    if (!file) {
+        errno = ENOENT;
+        LOG_ERROR("No such file");
+        return NULL;
+    }
+
+    catalog_header_t header;
+    if (fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, CATALOG_MAGIC, CATALOG_MAGIC_LEN) != 0
+        || header.version != CATALOG_VERSION || header.count >= CATALOG_NO_PARENT) {
+        fclose(file);
+        errno = EINVAL;
+        LOG_ERROR("Catalog file is invalid");
+        return NULL;
+    }
+
+    if (header.serial_number != pdisk->VBR->serial_number || header.image_size != image_size || header.image_mtime != image_mtime) {
+        fclose(file);
+        errno = EINVAL;
+        LOG_ERROR("Catalog is out of date");
+        return NULL;
+    }
+
+    //Columns are allocated only when the file really holds header.count rows
+    if (fseeko(file, 0, SEEK_END) != 0 || (uint64_t)ftello(file) != sizeof(header) + header.count * catalog_row_bytes()
+        || fseeko(file, sizeof(header), SEEK_SET) != 0) {
+        fclose(file);
+        errno = EINVAL;
+        LOG_ERROR("Catalog file is truncated");
+        return NULL;
+    }
+
+    struct catalog_t *catalog = (struct catalog_t*)calloc(1, sizeof(struct catalog_t));
+    if (!catalog || !catalog_reserve(catalog, header.count ? (size_t)header.count : 1)) {
+        if (catalog) catalog_close(catalog);
+        fclose(file);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    const size_t count = (size_t)header.count;
+    catalog->count = count;
+    catalog->serial_number = header.serial_number;
+    const bool success = fread(catalog->name, sizeof(*catalog->name), count, file) == count
+                         && fread(catalog->parent, sizeof(*catalog->parent), count, file) == count
+                         && fread(catalog->size, sizeof(*catalog->size), count, file) == count
+                         && fread(catalog->attributes, sizeof(*catalog->attributes), count, file) == count
+                         && fread(catalog->modify_time, sizeof(*catalog->modify_time), count, file) == count
+                         && fread(catalog->creation_time, sizeof(*catalog->creation_time), count, file) == count
+                         && fread(catalog->access_date, sizeof(*catalog->access_date), count, file) == count
+                         && fread(catalog->first_cluster, sizeof(*catalog->first_cluster), count, file) == count;
+    fclose(file);
+
+    //Names must stay terminated and parents must point at earlier directories for catalog_path()
+    for (size_t row = 0; success && row < count; row++) {
+        catalog->name[row][sizeof(*catalog->name) - 1] = '\x0';
+        if (catalog->parent[row] != CATALOG_NO_PARENT && catalog->parent[row] >= row) {
+            catalog_close(catalog);
+            errno = EINVAL;
+            LOG_ERROR("Catalog file is invalid");
+            return NULL;
+        }
+    }
+
+    if (!success) {
+        catalog_close(catalog);
+        errno = EINVAL;
+        LOG_ERROR("Catalog file is truncated");
+        return NULL;
+    }
+    return catalog;
+}
+
+
+struct diff_file_t {
+    char *path;
+    uint32_t row;
+};
+
+
+struct chain_reader_t {
+    struct volume_t *volume;
+    cluster_t cluster;
+    uint8_t *data;
+    size_t cluster_bytes;
+    size_t position;
+    size_t available;
+    uint32_t remaining;
+};
+
+
+static int compare_diff_files(const void* a, const void* b) {
+    return strcmp(((const struct diff_file_t*)a)->path, ((const struct diff_file_t*)b)->path);
+}
+
+
+/* Bytes needed for the path of the row, terminator included; directories are never that deep */
+static size_t catalog_path_length(const struct catalog_t* const catalog, uint32_t row) {
+    size_t length = 1;
+    for (size_t depth = 0; row != CATALOG_NO_PARENT && depth <= catalog->count; depth++) {
+        length += strlen(catalog->name[row]) + 1;
+        row = catalog->parent[row];
+    }
+    return length;
+}
+
+
+static void free_files(struct diff_file_t* files, const size_t amount) {
+    if (!files) return;
+    for (size_t i = 0; i < amount; i++) {
+        free(files[i].path);
+        files[i].path = NULL;
+    }
+    free(files);
+}
+
+
+/* Paths of all files (not directories) in the catalog, sorted; any depth is fine, paths live on the heap */
+static struct diff_file_t* collect_files(const struct catalog_t* const catalog, size_t* amount) {
+    struct diff_file_t *files = (struct diff_file_t*)malloc((catalog->count ? catalog->count : 1) * sizeof(struct diff_file_t));
+    if (!files) {
+        errno = ENOMEM;
+        LOG_ERROR("Not enough memory");
+        return NULL;
+    }
+
+    *amount = 0;
+    for (uint32_t row = 0; row < catalog->count; row++) {
+        if (catalog->attributes[row] & DIRECTORY) continue;
+
+        const size_t length = catalog_path_length(catalog, row);
+        files[*amount].path = (char*)malloc(length);
+        if (!files[*amount].path) {
+            free_files(files, *amount);
+            errno = ENOMEM;
+            LOG_ERROR("Not enough memory");
+            return NULL;
+        }
+        files[*amount].row = row;
+        (*amount)++;
+
+        if (catalog_path(catalog, row, files[*amount - 1].path, length) != 0) {
+            free_files(files, *amount);
+            return NULL;
+        }
+    }
+
+    qsort(files, *amount, sizeof(struct diff_file_t), compare_diff_files);
+    return files;
+}
+
+
+static size_t cluster_bytes_of(const struct volume_t* const volume) {
+    return (size_t)volume->disk->VBR->sectors_per_cluster * volume->disk->sector_size;
+}
+
+
+/* Data cluster that has an entry in FAT_mem, so get_next_cluster() may be called on it */
+static bool is_cluster_in_FAT(const cluster_t cluster, const struct volume_t* const volume) {
+    return cluster >= 2 && cluster < FAT_entries_of(volume) && cluster < EOC_MARKER_LOW_BOUNDARY;
+}
+
+
+/* Compares FAT chains of both files in memory, no data is read; broken chains are left to chain_reader_fill() */
+static bool are_chains_equal(const struct volume_t* const a, cluster_t cluster_a, const struct volume_t* const b, cluster_t cluster_b, const uint32_t size) {
+    if (cluster_bytes_of(a) != cluster_bytes_of(b)) return false;
+
+    for (size_t clusters = (size + cluster_bytes_of(a) - 1) / cluster_bytes_of(a); clusters > 0; clusters--) {
+        if (cluster_a != cluster_b) return false;
+        if (!is_cluster_in_FAT(cluster_a, a) || !is_cluster_in_FAT(cluster_b, b)) return false;
+        cluster_a = get_next_cluster(cluster_a, a);
+        cluster_b = get_next_cluster(cluster_b, b);
+    }
+    return true;
+}
+
+
+static bool chain_reader_fill(struct chain_reader_t* reader) {
+    if (reader->position < reader->available) return true;
+
+    if (!is_cluster_in_FAT(reader->cluster, reader->volume)) {
+        errno = EINVAL;
+        LOG_ERROR("Cluster chain is shorter than file or points outside FAT");
+        return false;
+    }
+
+    const uint8_t sectors_per_cluster = reader->volume->disk->VBR->sectors_per_cluster;
+    if (disk_read(reader->volume->disk, get_physical_address(reader->cluster, reader->volume), reader->data, sectors_per_cluster) != sectors_per_cluster) {
+        return false;
+    }
+
+    reader->available = reader->remaining < reader->cluster_bytes ? reader->remaining : reader->cluster_bytes;
+    reader->remaining -= (uint32_t)reader->available;
+    reader->position = 0;
+    reader->cluster = get_next_cluster(reader->cluster, reader->volume);
+    return true;
+}
+
+
+static bool append_range(struct diff_entry_t* entry, const uint32_t offset, const uint32_t length) {
+    if (entry->ranges_amount && entry->ranges[entry->ranges_amount - 1].offset + entry->ranges[entry->ranges_amount - 1].length == offset) {
+        entry->ranges[entry->ranges_amount - 1].length += length;
+        return true;
+    }
+
+    if (entry->ranges_amount == entry->ranges_capacity) {
+        const size_t capacity = entry->ranges_capacity ? entry->ranges_capacity * 2 : 8;
+        struct byte_range_t *ranges = (struct byte_range_t*)realloc(entry->ranges, capacity * sizeof(struct byte_range_t));
+        if (!ranges) {
+            errno = ENOMEM;
+            LOG_ERROR("Not enough memory");
+            return false;
+        }
+        entry->ranges = ranges;
+        entry->ranges_capacity = capacity;
+    }
+
+    entry->ranges[entry->ranges_amount].offset = offset;
+    entry->ranges[entry->ranges_amount].length = length;
+    entry->ranges_amount++;
+    return true;
+}
+
+
+/* Skips equal bytes 16 at a time; returns position of the first difference or length */
+static size_t first_difference(const uint8_t* a, const uint8_t* b, size_t position, const size_t length) {
+#ifdef __SSE2__
+    for (; position + 16 <= length; position += 16) {
+        const __m128i equal = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(a + position)), _mm_loadu_si128((const __m128i*)(b + position)));
+        const int mask = _mm_movemask_epi8(equal);
+        if (mask != 0xFFFF) return position + __builtin_ctz(~mask & 0xFFFF);
+    }
+#endif
+    for (; position < length && a[position] == b[position]; position++);
+    return position;
+}
+
+
+static bool compare_contents(struct chain_reader_t* a, struct chain_reader_t* b, const uint32_t common_size, struct diff_entry_t* entry) {
+    uint32_t offset = 0;
+
+    while (offset < common_size) {
+        if (!chain_reader_fill(a) || !chain_reader_fill(b)) return false;
+
+        size_t length = a->available - a->position < b->available - b->position ? a->available - a->position : b->available - b->position;
+        if (length > common_size - offset) length = common_size - offset;
+
+        const uint8_t *data_a = a->data + a->position, *data_b = b->data + b->position;
+        for (size_t position = first_difference(data_a, data_b, 0, length); position < length; position = first_difference(data_a, data_b, position, length)) {
+            const size_t changed_from = position;
+            for (; position < length && data_a[position] != data_b[position]; position++);
+            if (!append_range(entry, offset + (uint32_t)changed_from, (uint32_t)(position - changed_from))) return false;
+        }
+
+        a->position += length;
+        b->position += length;
+        offset += (uint32_t)length;
+    }
+    return true;
+}
+
+
+static bool diff_modified_file(struct volume_t* volume_a, const struct catalog_t* catalog_a, const uint32_t row_a,
+                               struct volume_t* volume_b, const struct catalog_t* catalog_b, const uint32_t row_b,
+                               struct diff_entry_t* entry) {
+    const uint32_t size_a = catalog_a->size[row_a], size_b = catalog_b->size[row_b];
+    const uint32_t common_size = size_a < size_b ? size_a : size_b;
+
+    struct chain_reader_t a = {volume_a, catalog_a->first_cluster[row_a], NULL, cluster_bytes_of(volume_a), 0, 0, common_size};
+    struct chain_reader_t b = {volume_b, catalog_b->first_cluster[row_b], NULL, cluster_bytes_of(volume_b), 0, 0, common_size};
+    a.data = (uint8_t*)malloc(a.cluster_bytes);
+    b.data = (uint8_t*)malloc(b.cluster_bytes);
+    if (!a.data || !b.data) {
+        free(a.data);
+        free(b.data);
+        errno = ENOMEM;
+        LOG_ERROR("Not enough memory");
+        return false;
+    }
+
+    bool success = compare_contents(&a, &b, common_size, entry);
+    if (success && size_a != size_b) {
+        success = append_range(entry, common_size, (size_a > size_b ? size_a : size_b) - common_size);
+    }
+
+    free(a.data);
+    free(b.data);
+    return success;
+}
+
+
+static struct diff_entry_t* diff_append(struct volume_diff_t* diff, const char* path, const diff_kind kind) {
+    char *path_copy = strdup(path);
+    if (!path_copy) {
+        errno = ENOMEM;
+        LOG_ERROR("Not enough memory");
+        return NULL;
+    }
+
+    if (diff->amount == diff->capacity) {
+        const size_t capacity = diff->capacity ? diff->capacity * 2 : 16;
+        struct diff_entry_t *entries = (struct diff_entry_t*)realloc(diff->entries, capacity * sizeof(struct diff_entry_t));
+        if (!entries) {
+            free(path_copy);
+            errno = ENOMEM;
+            LOG_ERROR("Not enough memory");
+            return NULL;
+        }
+        diff->entries = entries;
+        diff->capacity = capacity;
+    }
+
+    struct diff_entry_t *entry = diff->entries + diff->amount++;
+    memset(entry, 0, sizeof(*entry));
+    entry->path = path_copy;
+    entry->kind = kind;
+    return entry;
+}
+
+
+/* Merge-joins sorted file lists of both volumes; file content is read only when size, time or chain differ */
+static bool diff_files(struct volume_t* volume_a, const struct catalog_t* catalog_a, const struct diff_file_t* files_a, const size_t amount_a,
+                       struct volume_t* volume_b, const struct catalog_t* catalog_b, const struct diff_file_t* files_b, const size_t amount_b,
+                       struct volume_diff_t* diff) {
+    size_t i = 0, j = 0;
+
+    while (i < amount_a || j < amount_b) {
+        const int order = i == amount_a ? 1 : j == amount_b ? -1 : strcmp(files_a[i].path, files_b[j].path);
+
+        if (order < 0) {
+            if (!diff_append(diff, files_a[i++].path, DIFF_REMOVED)) return false;
+            continue;
+        }
+        if (order > 0) {
+            if (!diff_append(diff, files_b[j++].path, DIFF_ADDED)) return false;
+            continue;
+        }
+
+        const uint32_t row_a = files_a[i].row, row_b = files_b[j].row;
+        const bool unchanged = catalog_a->size[row_a] == catalog_b->size[row_b]
+                               && catalog_a->modify_time[row_a] == catalog_b->modify_time[row_b]
+                               && are_chains_equal(volume_a, catalog_a->first_cluster[row_a], volume_b, catalog_b->first_cluster[row_b], catalog_a->size[row_a]);
+        if (!unchanged) {
+            struct diff_entry_t *entry = diff_append(diff, files_b[j].path, DIFF_MODIFIED);
+            if (!entry || !diff_modified_file(volume_a, catalog_a, row_a, volume_b, catalog_b, row_b, entry)) return false;
+        }
+        i++;
+        j++;
+    }
+    return true;
+}
+
+
+struct volume_diff_t* volume_diff(struct volume_t* pvolume_a, struct volume_t* pvolume_b) {
+
+    if (!pvolume_a || !pvolume_b) {
+        errno = EFAULT;
+        LOG_ERROR("Null pointer exception");
+        return NULL;
+    }
+
+    struct volume_diff_t *diff = (struct volume_diff_t*)calloc(1, sizeof(struct volume_diff_t));
+    if (!diff) {
+        errno = ENOMEM;
+        LOG_ERROR("Not enough memory");
+        return NULL;
+    }
+
+    struct catalog_t *catalog_a = catalog_build(pvolume_a);
+    struct catalog_t *catalog_b = catalog_a ? catalog_build(pvolume_b) : NULL;
+    size_t amount_a = 0, amount_b = 0;
+    struct diff_file_t *files_a = catalog_b ? collect_files(catalog_a, &amount_a) : NULL;
+    struct diff_file_t *files_b = files_a ? collect_files(catalog_b, &amount_b) : NULL;
+
+    const bool success = files_b && diff_files(pvolume_a, catalog_a, files_a, amount_a, pvolume_b, catalog_b, files_b, amount_b, diff);
+
+    free_files(files_a, amount_a);
+    free_files(files_b, amount_b);
+    if (catalog_a) catalog_close(catalog_a);
+    if (catalog_b) catalog_close(catalog_b);
+
+    if (!success) {
+        volume_diff_close(diff);
+        return NULL;
+    }
+    return diff;
+}
+
+
+int volume_diff_close(struct volume_diff_t* pdiff) {
+    if (!pdiff) {
+        errno = EFAULT;
+        LOG_ERROR("Null pointer exception");
+        return -1;
+    }
+
+    for (size_t i = 0; i < pdiff->amount; i++) {
+        free(pdiff->entries[i].path);
+        pdiff->entries[i].path = NULL;
+        free(pdiff->entries[i].ranges);
+        pdiff->entries[i].ranges = NULL;
+    }
+    free(pdiff->entries);
+    pdiff->entries = NULL;
+    free(pdiff);
+    pdiff = NULL;
+    return 0;
+}
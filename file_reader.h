@@ -1,6 +1,10 @@
 #ifndef FILE_READER
 #define FILE_READER
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE     /* For O_DIRECT                                                         */
+#endif
+
 #include <stdio.h>      /* For size_t, perror(), printf(), fprintf(), f* family for files       */
 #include <stdlib.h>     /* For malloc() and its family                                          */
 #include <stdint.h>     /* For (u)int(*)_t types                                                */
@@ -9,9 +13,19 @@
 
 #include <errno.h>      /* For ERRNO and constants                                              */
 #include <string.h>     /* For strerror(), memcmp()                                             */
+#include <fcntl.h>      /* For open() and O_DIRECT                                              */
+#include <unistd.h>     /* For pread(), close()                                                 */
+#include <sys/stat.h>   /* For stat() identifying the image a catalog was built from            */
+#include <zlib.h>       /* For compress2(), uncompress() used by compressed images - link -lz   */
+#ifdef __SSE2__
+#include <emmintrin.h>  /* For SSE2 predicates scanning catalog columns                          */
+#endif
 
 
 #define SECTOR_SIZE 0x200
+#define MAX_SECTOR_SIZE 0x1000
+#define DIRECT_IO_BLOCK_SIZE 0x1000
+#define DIRECT_IO_WINDOW_SIZE (16 * DIRECT_IO_BLOCK_SIZE)
 #define SECTOR_END_MARKER_VALUE 0xAA55
 #define SIGNATURE_VALUE 0x29
 
@@ -24,6 +38,18 @@
 
 #define EOC_MARKER_LOW_BOUNDARY 0xFFF8
 
+#define COMPRESSED_IMAGE_MAGIC "FAT16CZ"
+#define COMPRESSED_IMAGE_MAGIC_LEN 8
+#define COMPRESSED_IMAGE_VERSION 1
+#define COMPRESSED_DEFAULT_BLOCK_SIZE 0x10000
+#define COMPRESSED_BLOCK_CACHE_SLOTS 8
+
+#define CATALOG_MAGIC "FAT16CAT"
+#define CATALOG_MAGIC_LEN 8
+#define CATALOG_VERSION 2
+#define CATALOG_FILE_SUFFIX ".cat"
+#define CATALOG_NO_PARENT UINT32_MAX
+
 #define SEEK_SET 0
 #define SEEK_CUR 1
 #define SEEK_END 2
@@ -36,6 +62,13 @@
 typedef uint32_t lba_t;
 typedef uint32_t cluster_t;
 
+typedef enum {DISK_BUFFERED_IO = 0x00, DISK_DIRECT_IO = 0x01} disk_flags;
+
+typedef enum {CATALOG_BY_NAME, CATALOG_BY_SIZE, CATALOG_BY_MODIFY_TIME,
+              CATALOG_BY_CREATION_TIME, CATALOG_BY_FIRST_CLUSTER} catalog_key;
+
+typedef enum {DIFF_ADDED, DIFF_REMOVED, DIFF_MODIFIED} diff_kind;
+
 typedef enum {READ_ONLY = 0x01, HIDDEN_FILE = 0x02, SYSTEM_FILE = 0x04,
               VOLUME_LABEL = 0x08, LONG_FILE_NAME = 0x0f, DIRECTORY = 0x10,
               ARCHIVE = 0x20, LFN = READ_ONLY | HIDDEN_FILE | SYSTEM_FILE | VOLUME_LABEL} __attribute__((packed))
@@ -106,9 +139,48 @@ typedef struct file_entry_t {
 } __attribute__((packed)) Entry_t;
 
 
+/* Compressed image: header | index of (blocks + 1) uint64_t file offsets | block 0 | block 1 | ...
+ * Every block holds block_size bytes of the raw image (the last one may be shorter) deflated
+ * independently; a block whose packed length equals its raw length is stored uncompressed.  */
+typedef struct compressed_header_t {
+    uint8_t magic[COMPRESSED_IMAGE_MAGIC_LEN];
+    uint32_t version;
+    uint32_t block_size;
+    uint64_t image_size;
+    uint32_t blocks;
+    uint32_t : 32;
+} __attribute__((packed)) compressed_header_t;
+
+
+struct block_cache_slot_t {
+    uint8_t *data;
+    int64_t block;
+    uint64_t last_used;
+};
+
+
+struct compressed_image_t {
+    compressed_header_t header;
+    uint64_t *index;
+    uint8_t *packed;
+    size_t packed_capacity;
+    uint64_t clock;
+    struct block_cache_slot_t cache[COMPRESSED_BLOCK_CACHE_SLOTS];
+};
+
+
+/* sector_size is SECTOR_SIZE until the VBR is read, then the volume's bytes_per_sector.
+ * With DISK_DIRECT_IO reads go through direct_fd in DIRECT_IO_BLOCK_SIZE aligned units,
+ * the last aligned window read is kept in io_window.                                       */
 struct disk_t {
     VBR_t *VBR;
     FILE *disk_file;
+    struct compressed_image_t *compressed;
+    uint16_t sector_size;
+    int direct_fd;
+    uint8_t *io_window;
+    uint64_t io_window_start;
+    size_t io_window_length;
 };
 
 struct dir_t {
@@ -141,6 +213,17 @@ struct file_t {
 };
 
 
+struct fat_time_t {
+    uint16_t year;
+    uint8_t month;
+    uint8_t day;
+    uint8_t hours;
+    uint8_t minutes;
+    uint8_t seconds;
+    uint8_t hundredths;
+};
+
+
 struct dir_entry_t {
     char name[14];
     size_t size;
@@ -149,9 +232,90 @@ struct dir_entry_t {
     bool is_system;
     bool is_hidden;
     bool is_directory;
+    cluster_t first_cluster;
+    struct fat_time_t creation_time;
+    struct fat_time_t modify_time;
+    struct fat_time_t access_date;
+};
+
+
+/* Column-wise counterpart of dir_entry_t. Every array is caller-owned and must hold at least
+ * `max` elements passed to dir_read_batch_soa(); a NULL column is simply not filled.          */
+struct dir_entries_soa_t {
+    char (*name)[14];
+    size_t *size;
+    uint8_t *attributes;
+    cluster_t *first_cluster;
+    struct fat_time_t *creation_time;
+    struct fat_time_t *modify_time;
+    struct fat_time_t *access_date;
+};
+
+/* Every file and directory of the volume, one row per entry, one array per field. Directories
+ * are listed before their content, parent holds the row of the containing directory. Times
+ * are packed FAT values (date << 16 | time), so their numeric order is the chronological one. */
+struct catalog_t {
+    size_t count;
+    size_t capacity;
+    uint32_t serial_number;
+    char (*name)[14];
+    uint32_t *parent;
+    uint32_t *size;
+    uint8_t *attributes;
+    uint32_t *modify_time;
+    uint32_t *creation_time;
+    uint16_t *access_date;
+    cluster_t *first_cluster;
+};
+
+
+/* serial_number, image_size and image_mtime identify the image the catalog was saved next to */
+typedef struct catalog_header_t {
+    uint8_t magic[CATALOG_MAGIC_LEN];
+    uint32_t version;
+    uint32_t serial_number;
+    uint64_t count;
+    uint64_t image_size;
+    int64_t image_mtime;
+} __attribute__((packed)) catalog_header_t;
+
+
+/* Bounds are inclusive, attribute masks equal to 0 are ignored; catalog_query_init() matches everything */
+struct catalog_query_t {
+    uint32_t min_size;
+    uint32_t max_size;
+    uint32_t modified_after;
+    uint32_t modified_before;
+    uint8_t attributes_all;
+    uint8_t attributes_any;
+    uint8_t attributes_none;
+};
+
+struct byte_range_t {
+    uint32_t offset;
+    uint32_t length;
+};
+
+
+/* ranges are set for DIFF_MODIFIED only; bytes past the end of the shorter file count as changed,
+ * ranges_amount equal to 0 means that only size, time or cluster chain of the file changed      */
+struct diff_entry_t {
+    char *path;
+    diff_kind kind;
+    struct byte_range_t *ranges;
+    size_t ranges_amount;
+    size_t ranges_capacity;
+};
+
+
+struct volume_diff_t {
+    struct diff_entry_t *entries;
+    size_t amount;
+    size_t capacity;
 };
 
 struct disk_t* disk_open_from_file(const char* volume_file_name);
+struct disk_t* disk_open_from_file_ex(const char* volume_file_name, disk_flags flags);
 int disk_read(struct disk_t* pdisk, int32_t first_sector, void* buffer, int32_t sectors_to_read);
 int disk_close(struct disk_t* pdisk);
 
@@ -165,6 +329,21 @@ int32_t file_seek(struct file_t* stream, int32_t offset, int whence);
 
 struct dir_t* dir_open(struct volume_t* pvolume, const char* dir_path);
 int dir_read(struct dir_t* pdir, struct dir_entry_t* pentry);
+int dir_read_batch(struct dir_t* pdir, struct dir_entry_t* entries, size_t max);
+int dir_read_batch_soa(struct dir_t* pdir, struct dir_entries_soa_t* columns, size_t max);
 int dir_close(struct dir_t* pdir);
 
+uint32_t fat_timestamp(const struct fat_time_t* time);
+struct catalog_t* catalog_build(struct volume_t* pvolume);
+int catalog_close(struct catalog_t* pcatalog);
+void catalog_query_init(struct catalog_query_t* query);
+int catalog_filter(const struct catalog_t* pcatalog, const struct catalog_query_t* query, uint32_t* rows, size_t max);
+int catalog_sort(const struct catalog_t* pcatalog, uint32_t* rows, size_t count, catalog_key key, bool descending);
+int catalog_path(const struct catalog_t* pcatalog, uint32_t row, char* buffer, size_t buffer_size);
+int catalog_save(const struct catalog_t* pcatalog, const char* volume_file_name);
+struct catalog_t* catalog_load(const struct disk_t* pdisk, const char* volume_file_name);
+
+struct volume_diff_t* volume_diff(struct volume_t* pvolume_a, struct volume_t* pvolume_b);
+int volume_diff_close(struct volume_diff_t* pdiff);
+
 #endif
@@ -0,0 +1,105 @@
+#include "file_reader.h"
+
+/* Converts raw FAT16 image into seekable compressed image understood by disk_open_from_file()
+ * Usage: image_compressor <raw image> <compressed image> [block size in KiB]                   */
+
+
+static bool write_block(FILE* to, const uint8_t* raw, const size_t raw_length, uint8_t* packed, const size_t packed_capacity) {
+    uLongf packed_length = packed_capacity;
+    if (compress2(packed, &packed_length, raw, raw_length, Z_BEST_COMPRESSION) == Z_OK && packed_length < raw_length) {
+        return fwrite(packed, 1, packed_length, to) == packed_length;
+    }
+    return fwrite(raw, 1, raw_length, to) == raw_length;
+}
+
+
+static bool compress_image(FILE* from, FILE* to, const uint32_t block_size) {
+    if (fseek(from, 0, SEEK_END) != 0) return false;
+    const uint64_t image_size = (uint64_t)ftell(from);
+    rewind(from);
+
+    compressed_header_t header = {0};
+    memcpy(header.magic, COMPRESSED_IMAGE_MAGIC, COMPRESSED_IMAGE_MAGIC_LEN);
+    header.version = COMPRESSED_IMAGE_VERSION;
+    header.block_size = block_size;
+    header.image_size = image_size;
+    header.blocks = (uint32_t)((image_size + block_size - 1) / block_size);
+
+    const size_t packed_capacity = compressBound(block_size);
+    uint64_t *index = (uint64_t*)calloc(header.blocks + 1ULL, sizeof(uint64_t));
+    uint8_t *raw = (uint8_t*)malloc(block_size);
+    uint8_t *packed = (uint8_t*)malloc(packed_capacity);
+    if (!index || !raw || !packed) {
+        free(index);
+        free(raw);
+        free(packed);
+        errno = ENOMEM;
+        LOG_ERROR("Not enough memory");
+        return false;
+    }
+
+    bool success = fwrite(&header, sizeof(header), 1, to) == 1
+                   && fwrite(index, sizeof(uint64_t), header.blocks + 1ULL, to) == header.blocks + 1ULL;
+
+    for (uint32_t i = 0; success && i < header.blocks; i++) {
+        index[i] = (uint64_t)ftell(to);
+        const size_t raw_length = fread(raw, 1, block_size, from);
+        success = raw_length == block_size || (i + 1 == header.blocks && raw_length == image_size % block_size);
+        success = success && write_block(to, raw, raw_length, packed, packed_capacity);
+    }
+
+    if (success) {
+        index[header.blocks] = (uint64_t)ftell(to);
+        success = fseek(to, sizeof(header), SEEK_SET) == 0
+                  && fwrite(index, sizeof(uint64_t), header.blocks + 1ULL, to) == header.blocks + 1ULL;
+    }
+
+    free(index);
+    free(raw);
+    free(packed);
+    return success;
+}
+
+
+int main(int argc, char** argv) {
+    if (argc < 3 || argc > 4) {
+        fprintf(stderr, "Usage: %s <raw image> <compressed image> [block size in KiB]\n", argv[0]);
+        return 1;
+    }
+
+    uint32_t block_size = COMPRESSED_DEFAULT_BLOCK_SIZE;
+    if (argc == 4) {
+        const long kib = strtol(argv[3], NULL, 10);
+        if (kib <= 0 || kib > 0x4000) {
+            errno = EINVAL;
+            LOG_ERROR("Block size must be between 1 and 16384 KiB");
+            return 1;
+        }
+        block_size = (uint32_t)kib * 1024;
+    }
+
+    FILE *from = fopen(argv[1], "rb");
+    if (!from) {
+        LOG_ERROR("Could not open raw image");
+        return 1;
+    }
+
+    FILE *to = fopen(argv[2], "wb");
+    if (!to) {
+        LOG_ERROR("Could not create compressed image");
+        fclose(from);
+        return 1;
+    }
+
+    const bool success = compress_image(from, to, block_size);
+    if (!success) {
+        LOG_ERROR("Could not compress image");
+    }
+
+    fclose(from);
+    if (fclose(to) != 0 || !success) {
+        remove(argv[2]);
+        return 1;
+    }
+    return 0;
+}